@@ -7,6 +7,7 @@
 #include <SFML/Graphics/VertexArray.hpp>
 #include <iostream>
 #include <fstream>
+#include <functional>
 #include <vector>
 #include <memory>
 #include <unordered_map>
@@ -375,10 +376,15 @@ namespace physics {
         }
     }
 
-    inline void displayWorld(b2WorldId worldId, sf::RenderWindow& render) {
+    // onStep runs right after the world step, while its body events are still valid (e.g. for recording)
+    inline void displayWorld(b2WorldId worldId, sf::RenderWindow& render, const std::function<void(b2WorldId)>& onStep = nullptr) {
         float timeStep = 1.0f / 60.0f;
         b2World_Step(worldId, timeStep, 4);
 
+        if (onStep) {
+            onStep(worldId);
+        }
+
         // Process move events for accurate post-collision positions
         b2BodyEvents events = b2World_GetBodyEvents(worldId);
         for (int i = 0; i < events.moveCount; ++i) {
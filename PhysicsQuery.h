@@ -0,0 +1,413 @@
+#ifndef PHYSICS_QUERY_H_INCLUDED
+#define PHYSICS_QUERY_H_INCLUDED
+
+#include "PhysicsDebugDraw.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Batched spatial queries (ray casts, AABB overlaps, shape casts) against the world.
+// All positions are in pixels, like the create* functions; conversion to meters happens here.
+namespace physics {
+    struct QueryHit {
+        b2ShapeId shapeId = b2_nullShapeId;
+        b2BodyId bodyId = b2_nullBodyId;
+        PhysicsObject* object = nullptr; // Registry entry, nullptr if the body is not in physicsObjects
+        sf::Vector2f point;  // Pixels (unused for overlaps)
+        sf::Vector2f normal;
+        float fraction = 1.0f; // Fraction of the ray/translation travelled before the hit
+        bool hit = false;
+    };
+
+    struct RayQuery {
+        b2Vec2 origin;
+        b2Vec2 translation;
+        b2QueryFilter filter;
+        bool allHits = false;
+        QueryHit result;            // Closest hit
+        std::vector<QueryHit> hits; // Every hit along the ray sorted by fraction, only filled when allHits is set
+    };
+
+    struct OverlapQuery {
+        b2AABB box;
+        b2QueryFilter filter;
+        std::vector<QueryHit> results; // Every shape whose bounding box overlaps
+    };
+
+    struct ShapeCastQuery {
+        b2ShapeProxy proxy;
+        b2Vec2 translation;
+        b2QueryFilter filter;
+        QueryHit result; // Closest hit
+    };
+
+    class QuerySystem;
+
+    // A batch is reusable: clear() keeps every query slot and its result storage, so per-frame
+    // batches don't hit the heap. Results are read back by the index the add* call returned.
+    class QueryBatch {
+    public:
+        // allHits casts with b2World_CastRay and collects everything along the ray, otherwise only the closest hit is kept
+        int addRay(sf::Vector2f start, sf::Vector2f end, b2QueryFilter filter = b2DefaultQueryFilter(), bool allHits = false) {
+            RayQuery& query = nextSlot(rays, rayCount);
+            query.origin = (b2Vec2){start.x/pixels_per_meter, start.y/pixels_per_meter};
+            query.translation = (b2Vec2){(end.x - start.x)/pixels_per_meter, (end.y - start.y)/pixels_per_meter};
+            query.filter = filter;
+            query.allHits = allHits;
+            return static_cast<int>(rayCount) - 1;
+        }
+
+        int addOverlap(sf::Vector2f lower, sf::Vector2f upper, b2QueryFilter filter = b2DefaultQueryFilter()) {
+            OverlapQuery& query = nextSlot(overlaps, overlapCount);
+            query.box.lowerBound = (b2Vec2){lower.x/pixels_per_meter, lower.y/pixels_per_meter};
+            query.box.upperBound = (b2Vec2){upper.x/pixels_per_meter, upper.y/pixels_per_meter};
+            query.filter = filter;
+            return static_cast<int>(overlapCount) - 1;
+        }
+
+        // points are world positions of a convex shape (at most B2_MAX_POLYGON_VERTICES), swept by translation
+        int addShapeCast(const std::vector<sf::Vector2f>& points, float radius, sf::Vector2f translation,
+                         b2QueryFilter filter = b2DefaultQueryFilter()) {
+            int n = std::min(static_cast<int>(points.size()), B2_MAX_POLYGON_VERTICES);
+            if (n < 1) {
+                std::cout << "Shape cast needs at least one point" << std::endl;
+                return -1;
+            }
+
+            b2Vec2 converted[B2_MAX_POLYGON_VERTICES];
+            for (int i = 0; i < n; i++) {
+                converted[i] = (b2Vec2){points[i].x/pixels_per_meter, points[i].y/pixels_per_meter};
+            }
+
+            ShapeCastQuery& query = nextSlot(shapeCasts, shapeCastCount);
+            query.proxy = b2MakeProxy(converted, n, radius/pixels_per_meter);
+            query.translation = (b2Vec2){translation.x/pixels_per_meter, translation.y/pixels_per_meter};
+            query.filter = filter;
+            return static_cast<int>(shapeCastCount) - 1;
+        }
+
+        const QueryHit& ray(int i) const {
+            return rays[i].result;
+        }
+
+        const std::vector<QueryHit>& rayHits(int i) const {
+            return rays[i].hits;
+        }
+
+        const std::vector<QueryHit>& overlap(int i) const {
+            return overlaps[i].results;
+        }
+
+        const QueryHit& shapeCast(int i) const {
+            return shapeCasts[i].result;
+        }
+
+        size_t size() const {
+            return rayCount + overlapCount + shapeCastCount;
+        }
+
+        void clear() {
+            rayCount = 0;
+            overlapCount = 0;
+            shapeCastCount = 0;
+        }
+
+    private:
+        friend class QuerySystem;
+
+        // Reuses the slot past count if there is one, so its vectors keep their capacity
+        template <typename Query>
+        static Query& nextSlot(std::vector<Query>& queries, size_t& count) {
+            if (queries.size() == count) {
+                queries.emplace_back();
+            }
+            return queries[count++];
+        }
+
+        std::vector<RayQuery> rays;
+        std::vector<OverlapQuery> overlaps;
+        std::vector<ShapeCastQuery> shapeCasts;
+        size_t rayCount = 0;
+        size_t overlapCount = 0;
+        size_t shapeCastCount = 0;
+    };
+
+    // Look up the registry entry for a body, checking the generation so a recycled index doesn't match
+    inline PhysicsObject* findObject(b2BodyId bodyId) {
+        auto it = physicsObjects.find(bodyId.index1);
+        if (it == physicsObjects.end() || !B2_ID_EQUALS(it->second.bodyId, bodyId)) {
+            return nullptr;
+        }
+        return &it->second;
+    }
+
+    inline void fillHit(QueryHit& hit, b2ShapeId shapeId, b2Vec2 point, b2Vec2 normal, float fraction) {
+        hit.shapeId = shapeId;
+        hit.bodyId = b2Shape_GetBody(shapeId);
+        hit.object = findObject(hit.bodyId);
+        hit.point = sf::Vector2f(point.x * pixels_per_meter, point.y * pixels_per_meter);
+        hit.normal = sf::Vector2f(normal.x, normal.y);
+        hit.fraction = fraction;
+        hit.hit = true;
+    }
+
+    inline float rayHitsCallback(b2ShapeId shapeId, b2Vec2 point, b2Vec2 normal, float fraction, void* context) {
+        auto* hits = static_cast<std::vector<QueryHit>*>(context);
+        hits->emplace_back();
+        fillHit(hits->back(), shapeId, point, normal, fraction);
+        return 1.0f; // Don't clip, we want every hit along the ray
+    }
+
+    inline void runRayQuery(b2WorldId worldId, RayQuery& query) {
+        query.result = QueryHit();
+        query.hits.clear();
+
+        if (query.allHits) {
+            b2World_CastRay(worldId, query.origin, query.translation, query.filter, rayHitsCallback, &query.hits);
+
+            // Box2D reports hits in tree order, not along the ray
+            std::sort(query.hits.begin(), query.hits.end(),
+                      [](const QueryHit& a, const QueryHit& b) { return a.fraction < b.fraction; });
+            if (!query.hits.empty()) {
+                query.result = query.hits.front();
+            }
+            return;
+        }
+
+        b2RayResult ray = b2World_CastRayClosest(worldId, query.origin, query.translation, query.filter);
+        if (ray.hit) {
+            fillHit(query.result, ray.shapeId, ray.point, ray.normal, ray.fraction);
+        }
+    }
+
+    inline bool overlapCallback(b2ShapeId shapeId, void* context) {
+        auto* results = static_cast<std::vector<QueryHit>*>(context);
+        QueryHit hit;
+        hit.shapeId = shapeId;
+        hit.bodyId = b2Shape_GetBody(shapeId);
+        hit.object = findObject(hit.bodyId);
+        hit.hit = true;
+        results->push_back(hit);
+        return true; // Keep going, we want every overlap
+    }
+
+    inline void runOverlapQuery(b2WorldId worldId, OverlapQuery& query) {
+        query.results.clear();
+        b2World_OverlapAABB(worldId, query.box, query.filter, overlapCallback, &query.results);
+    }
+
+    inline float shapeCastCallback(b2ShapeId shapeId, b2Vec2 point, b2Vec2 normal, float fraction, void* context) {
+        auto* result = static_cast<QueryHit*>(context);
+        fillHit(*result, shapeId, point, normal, fraction);
+        return fraction; // Clip the cast so only closer hits are reported afterwards
+    }
+
+    inline void runShapeCastQuery(b2WorldId worldId, ShapeCastQuery& query) {
+        query.result = QueryHit();
+        b2World_CastShape(worldId, &query.proxy, query.translation, query.filter, shapeCastCallback, &query.result);
+    }
+
+    // Runs query batches on a fixed set of worker threads plus the calling thread.
+    // execute() must be called between world steps: queries only read the world and the
+    // physicsObjects registry, so nothing may create, destroy or step while it runs.
+    class QuerySystem {
+    public:
+        explicit QuerySystem(unsigned int threads = std::thread::hardware_concurrency()) {
+            // The calling thread also works, so spawn one less
+            unsigned int workerCount = threads > 1 ? threads - 1 : 0;
+            for (unsigned int i = 0; i < workerCount; ++i) {
+                workers.emplace_back(&QuerySystem::workerLoop, this);
+            }
+        }
+
+        ~QuerySystem() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wakeCondition.notify_all();
+            for (auto& worker : workers) {
+                worker.join();
+            }
+        }
+
+        QuerySystem(const QuerySystem&) = delete;
+        QuerySystem& operator=(const QuerySystem&) = delete;
+
+        // Blocks until every query in the batch has its result filled in
+        void execute(b2WorldId worldId, QueryBatch& batch) {
+            currentWorld = worldId;
+            currentBatch = &batch;
+            jobCount = batch.size();
+            nextJob.store(0);
+
+            // Large batches are claimed in chunks to keep the atomic cheap, small ones
+            // one query at a time so they still spread over every thread
+            chunkSize = std::clamp<size_t>(jobCount / (threadCount() * 4), 1, maxChunkSize);
+
+            if (workers.empty() || jobCount == 0) {
+                runJobs();
+                currentBatch = nullptr;
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                activeWorkers = static_cast<int>(workers.size());
+                ++generation;
+            }
+            wakeCondition.notify_all();
+
+            runJobs();
+
+            std::unique_lock<std::mutex> lock(mutex);
+            doneCondition.wait(lock, [this] { return activeWorkers == 0; });
+            currentBatch = nullptr;
+        }
+
+        size_t threadCount() const {
+            return workers.size() + 1;
+        }
+
+    private:
+        static constexpr size_t maxChunkSize = 32; // Queries claimed per atomic increment
+
+        void workerLoop() {
+            uint64_t seenGeneration = 0;
+            while (true) {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeCondition.wait(lock, [&] { return stopping || generation != seenGeneration; });
+                if (stopping) {
+                    return;
+                }
+                seenGeneration = generation;
+                lock.unlock();
+
+                runJobs();
+
+                lock.lock();
+                if (--activeWorkers == 0) {
+                    doneCondition.notify_one();
+                }
+            }
+        }
+
+        void runJobs() {
+            QueryBatch& batch = *currentBatch;
+            size_t rayEnd = batch.rayCount;
+            size_t overlapEnd = rayEnd + batch.overlapCount;
+
+            while (true) {
+                size_t begin = nextJob.fetch_add(chunkSize);
+                if (begin >= jobCount) {
+                    return;
+                }
+                size_t end = std::min(begin + chunkSize, jobCount);
+
+                // Jobs are numbered rays first, then overlaps, then shape casts
+                for (size_t i = begin; i < end; ++i) {
+                    if (i < rayEnd) {
+                        runRayQuery(currentWorld, batch.rays[i]);
+                    } else if (i < overlapEnd) {
+                        runOverlapQuery(currentWorld, batch.overlaps[i - rayEnd]);
+                    } else {
+                        runShapeCastQuery(currentWorld, batch.shapeCasts[i - overlapEnd]);
+                    }
+                }
+            }
+        }
+
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable wakeCondition;
+        std::condition_variable doneCondition;
+        uint64_t generation = 0;
+        int activeWorkers = 0;
+        bool stopping = false;
+
+        b2WorldId currentWorld = b2_nullWorldId;
+        QueryBatch* currentBatch = nullptr;
+        size_t jobCount = 0;
+        size_t chunkSize = 1;
+        std::atomic<size_t> nextJob{0};
+    };
+
+    struct MouseDrag {
+        b2BodyId groundId = b2_nullBodyId; // Static anchor for the mouse joint, created on first use
+        b2JointId jointId = b2_nullJointId;
+        QueryBatch pickBatch; // Reused for every click
+    };
+
+    // Returns the dynamic body under a pixel position, or b2_nullBodyId
+    inline b2BodyId pickBody(QuerySystem& querySystem, b2WorldId worldId, QueryBatch& batch, sf::Vector2f point) {
+        sf::Vector2f d = {0.001f * pixels_per_meter, 0.001f * pixels_per_meter};
+
+        batch.clear();
+        int query = batch.addOverlap(point - d, point + d);
+        querySystem.execute(worldId, batch);
+
+        b2Vec2 p = {point.x/pixels_per_meter, point.y/pixels_per_meter};
+        for (const QueryHit& hit : batch.overlap(query)) {
+            if (b2Body_GetType(hit.bodyId) != b2_dynamicBody) {
+                continue; // Can't drag walls or the ground
+            }
+
+            // The broad-phase only tests bounding boxes, make sure the point is really inside
+            if (b2Shape_TestPoint(hit.shapeId, p)) {
+                return hit.bodyId;
+            }
+        }
+
+        return b2_nullBodyId;
+    }
+
+    inline void endMouseDrag(MouseDrag& drag) {
+        if (B2_IS_NON_NULL(drag.jointId) && b2Joint_IsValid(drag.jointId)) {
+            b2DestroyJoint(drag.jointId);
+        }
+        drag.jointId = b2_nullJointId;
+    }
+
+    inline bool beginMouseDrag(QuerySystem& querySystem, b2WorldId worldId, MouseDrag& drag, sf::Vector2f point) {
+        // A missed release (e.g. outside the window) would otherwise leave the old joint pulling
+        endMouseDrag(drag);
+
+        b2BodyId bodyId = pickBody(querySystem, worldId, drag.pickBatch, point);
+        if (B2_IS_NULL(bodyId)) {
+            return false;
+        }
+
+        if (B2_IS_NULL(drag.groundId) || !b2Body_IsValid(drag.groundId)) {
+            b2BodyDef bodyDef = b2DefaultBodyDef();
+            drag.groundId = b2CreateBody(worldId, &bodyDef);
+        }
+
+        b2MouseJointDef jointDef = b2DefaultMouseJointDef();
+        jointDef.bodyIdA = drag.groundId;
+        jointDef.bodyIdB = bodyId;
+        jointDef.target = (b2Vec2){point.x/pixels_per_meter, point.y/pixels_per_meter};
+        jointDef.hertz = 5.0f;
+        jointDef.dampingRatio = 0.7f;
+        jointDef.maxForce = 1000.0f * b2Body_GetMass(bodyId);
+
+        drag.jointId = b2CreateMouseJoint(worldId, &jointDef);
+        b2Body_SetAwake(bodyId, true);
+
+        return true;
+    }
+
+    inline void updateMouseDrag(MouseDrag& drag, sf::Vector2f point) {
+        // The joint goes away with its body, e.g. on reset
+        if (B2_IS_NULL(drag.jointId) || !b2Joint_IsValid(drag.jointId)) {
+            drag.jointId = b2_nullJointId;
+            return;
+        }
+
+        b2MouseJoint_SetTarget(drag.jointId, (b2Vec2){point.x/pixels_per_meter, point.y/pixels_per_meter});
+        b2Body_SetAwake(b2Joint_GetBodyB(drag.jointId), true);
+    }
+}
+
+#endif // PHYSICS_QUERY_H_INCLUDED
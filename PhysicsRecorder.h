@@ -0,0 +1,368 @@
+#ifndef PHYSICS_RECORDER_H_INCLUDED
+#define PHYSICS_RECORDER_H_INCLUDED
+
+#include "PhysicsDebugDraw.h"
+#include "PhysicsTrajectory.h"
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+namespace physics {
+    // Records every world step's body moves to a trajectory file (see PhysicsTrajectory.h).
+    // Encoding happens on the calling thread; disk writes happen on a writer thread using
+    // two buffers, so recordStep() never waits for the disk.
+    class TrajectoryRecorder {
+    public:
+        TrajectoryRecorder() = default;
+
+        ~TrajectoryRecorder() {
+            close();
+        }
+
+        TrajectoryRecorder(const TrajectoryRecorder&) = delete;
+        TrajectoryRecorder& operator=(const TrajectoryRecorder&) = delete;
+
+        bool open(const std::string& path, float timeStep, uint32_t keyframeInterval = 300) {
+            close();
+
+            file = std::fopen(path.c_str(), "wb");
+            if (!file) {
+                std::cout << "Failed to open trajectory file " << path << std::endl;
+                return false;
+            }
+
+            header.timeStep = timeStep;
+            header.pixelsPerMeter = pixels_per_meter;
+            header.keyframeInterval = keyframeInterval > 0 ? keyframeInterval : 1;
+
+            states.clear();
+            ids.clear();
+            stamps.clear();
+            residuals.clear();
+            removed.clear();
+            toggled.clear();
+            movedKeys.clear();
+            frameIndex = 0;
+            bytesRecorded = 0;
+
+            // Both buffers get room up front so swapping them never leaves the encoder growing one
+            front.clear();
+            front.reserve(flushThreshold * 2);
+            back.clear();
+            back.reserve(flushThreshold * 2);
+            trajectory::writeFileHeader(front, header);
+
+            stopping = false;
+            backPending = false;
+            writerThread = std::thread(&TrajectoryRecorder::writerLoop, this);
+
+            return true;
+        }
+
+        // Call right after b2World_Step, while its body events are still valid
+        void recordStep(b2WorldId worldId) {
+            if (!file) {
+                return;
+            }
+
+            bool isKeyframe = frameIndex % header.keyframeInterval == 0;
+            b2BodyEvents events = b2World_GetBodyEvents(worldId);
+            removed.clear();
+
+            // A recycled index means the old body is gone
+            for (int i = 0; i < events.moveCount; ++i) {
+                b2BodyId bodyId = events.moveEvents[i].bodyId;
+                size_t key = static_cast<size_t>(bodyId.index1);
+                if (key >= states.size()) {
+                    states.resize(key + 1);
+                    ids.resize(key + 1, b2_nullBodyId);
+                    stamps.resize(key + 1, -1);
+                }
+                if (states[key].alive && !B2_ID_EQUALS(ids[key], bodyId)) {
+                    removeBody(key);
+                }
+            }
+
+            // Destroyed bodies don't send events, so check the ones we track. The body count
+            // can't be used as a shortcut since a reset destroys and creates the same number.
+            for (size_t key = 0; key < states.size(); ++key) {
+                if (states[key].alive && !b2Body_IsValid(ids[key])) {
+                    removeBody(key);
+                }
+            }
+
+            size_t frameStart = front.size();
+            front.push_back(isKeyframe ? trajectory::KeyFrame : trajectory::DeltaFrame);
+            trajectory::putU32(front, static_cast<uint32_t>(frameIndex));
+            trajectory::putU32(front, 0); // Payload size, patched below
+            size_t payloadStart = front.size();
+
+            if (isKeyframe) {
+                for (int i = 0; i < events.moveCount; ++i) {
+                    applyMove(events.moveEvents[i]);
+                }
+                writeKeyframe();
+            } else {
+                writeDelta(events);
+            }
+
+            uint32_t payloadSize = static_cast<uint32_t>(front.size() - payloadStart);
+            for (int i = 0; i < 4; i++) {
+                front[payloadStart - 4 + i] = static_cast<uint8_t>(payloadSize >> (8 * i));
+            }
+
+            bytesRecorded += front.size() - frameStart;
+            ++frameIndex;
+
+            if (front.size() >= flushThreshold) {
+                handOff();
+            }
+        }
+
+        // Flushes everything to disk and closes the file (blocks until written)
+        void close() {
+            if (!file) {
+                return;
+            }
+
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                writtenCondition.wait(lock, [this] { return !backPending; });
+                std::swap(front, back);
+                backPending = !back.empty();
+                stopping = true;
+            }
+            pendingCondition.notify_one();
+            writerThread.join();
+
+            std::fclose(file);
+            file = nullptr;
+            front.clear();
+            back.clear();
+        }
+
+        bool isOpen() const {
+            return file != nullptr;
+        }
+
+        size_t frames() const {
+            return frameIndex;
+        }
+
+        uint64_t bytes() const {
+            return bytesRecorded;
+        }
+
+    private:
+        static constexpr size_t flushThreshold = 4 * 1024 * 1024;
+
+        void removeBody(size_t key) {
+            states[key] = trajectory::BodyState();
+            ids[key] = b2_nullBodyId;
+            removed.push_back(static_cast<uint32_t>(key));
+        }
+
+        // Residual for a prediction error, in quantization steps. Errors within one step keep
+        // the prediction, so constant velocity costs nothing instead of alternating +-1 from
+        // rounding; the reconstruction stays within one step of the true value.
+        static int32_t residualFor(float error) {
+            int32_t rounded = static_cast<int32_t>(error + std::copysign(0.5f, error));
+            return std::fabs(error) > 1.0f ? rounded : 0;
+        }
+
+        // Updates the state of a moved body to what the reader will reconstruct, returns the prediction residuals
+        void applyMove(const b2BodyMoveEvent& event, int32_t* rx = nullptr, int32_t* ry = nullptr, int32_t* ra = nullptr) {
+            size_t key = static_cast<size_t>(event.bodyId.index1);
+            trajectory::BodyState& state = states[key];
+
+            float tx = event.transform.p.x * header.positionScale;
+            float ty = event.transform.p.y * header.positionScale;
+            float radians = b2Rot_GetAngle(event.transform.q);
+
+            int32_t x, y;
+            uint16_t angle;
+            if (rx) {
+                // New bodies start from zero, so their first residual is the absolute value
+                int32_t px = state.x + state.dx;
+                int32_t py = state.y + state.dy;
+                int32_t pa = state.angle + state.dangle;
+
+                *rx = residualFor(tx - static_cast<float>(px));
+                *ry = residualFor(ty - static_cast<float>(py));
+                float ta = radians * (trajectory::angleSteps / 6.28318530718f);
+                float angleError = ta - static_cast<float>(pa);
+                while (angleError >= trajectory::angleSteps / 2) {
+                    angleError -= trajectory::angleSteps;
+                }
+                while (angleError < -trajectory::angleSteps / 2) {
+                    angleError += trajectory::angleSteps;
+                }
+                *ra = residualFor(angleError);
+
+                x = px + *rx;
+                y = py + *ry;
+                angle = static_cast<uint16_t>((pa + *ra) & (trajectory::angleSteps - 1));
+            } else {
+                x = static_cast<int32_t>(tx + (tx < 0.0f ? -0.5f : 0.5f));
+                y = static_cast<int32_t>(ty + (ty < 0.0f ? -0.5f : 0.5f));
+                angle = trajectory::quantizeAngle(radians);
+            }
+
+            state.dx = x - state.x;
+            state.dy = y - state.y;
+            state.dangle = trajectory::wrapAngle(angle - state.angle);
+            state.x = x;
+            state.y = y;
+            state.angle = angle;
+            state.alive = true;
+
+            ids[key] = event.bodyId;
+            stamps[key] = static_cast<int64_t>(frameIndex);
+        }
+
+        void writeKeyframe() {
+            uint32_t count = 0;
+            for (const auto& state : states) {
+                count += state.alive ? 1 : 0;
+            }
+            trajectory::putVarint(front, count);
+
+            uint32_t previousKey = 0;
+            for (size_t key = 0; key < states.size(); ++key) {
+                trajectory::BodyState& state = states[key];
+                if (!state.alive) {
+                    continue;
+                }
+                trajectory::putVarint(front, static_cast<uint32_t>(key) - previousKey);
+                trajectory::putSigned(front, state.x);
+                trajectory::putSigned(front, state.y);
+                trajectory::putVarint(front, state.angle);
+                previousKey = static_cast<uint32_t>(key);
+
+                // Prediction and the moving set restart at every keyframe so the reader can seek to it
+                state.dx = 0;
+                state.dy = 0;
+                state.dangle = 0;
+                state.moving = false;
+            }
+        }
+
+        void writeDelta(const b2BodyEvents& events) {
+            trajectory::putVarint(front, static_cast<uint32_t>(removed.size()));
+            for (uint32_t key : removed) {
+                trajectory::putVarint(front, key);
+            }
+
+            // Residuals go in a scratch array so bodies can be written in key order
+            // without sorting the events
+            if (residuals.size() < states.size()) {
+                residuals.resize(states.size());
+            }
+            for (int i = 0; i < events.moveCount; ++i) {
+                const b2BodyMoveEvent& event = events.moveEvents[i];
+                Residual& r = residuals[event.bodyId.index1];
+                applyMove(event, &r.x, &r.y, &r.angle);
+            }
+
+            // Only bodies that started or stopped moving are listed
+            toggled.clear();
+            movedKeys.clear();
+            int64_t stamp = static_cast<int64_t>(frameIndex);
+            for (size_t key = 0; key < states.size(); ++key) {
+                bool moved = stamps[key] == stamp;
+                if (moved != states[key].moving) {
+                    states[key].moving = moved;
+                    toggled.push_back(static_cast<uint32_t>(key));
+                }
+                if (moved) {
+                    movedKeys.push_back(static_cast<uint32_t>(key));
+                }
+            }
+
+            trajectory::putVarint(front, static_cast<uint32_t>(toggled.size()));
+            uint32_t previousKey = 0;
+            for (uint32_t key : toggled) {
+                trajectory::putVarint(front, key - previousKey);
+                previousKey = key;
+            }
+
+            trajectory::BitWriter bits(front);
+            for (uint32_t key : movedKeys) {
+                const Residual& r = residuals[key];
+                if (r.x == 0 && r.y == 0 && r.angle == 0) {
+                    bits.putBits(1, 1);
+                    continue;
+                }
+                bits.putBits(0, 1);
+                bits.putExpGolomb(trajectory::zigzag(r.x));
+                bits.putExpGolomb(trajectory::zigzag(r.y));
+                bits.putExpGolomb(trajectory::zigzag(r.angle));
+            }
+            bits.finish();
+        }
+
+        // Gives the filled buffer to the writer, unless it's still busy with the other one;
+        // in that case keep appending and try again next step rather than wait
+        void handOff() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (backPending) {
+                    return;
+                }
+                std::swap(front, back);
+                backPending = true;
+            }
+            pendingCondition.notify_one();
+        }
+
+        void writerLoop() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                pendingCondition.wait(lock, [this] { return backPending || stopping; });
+                if (backPending) {
+                    lock.unlock();
+                    if (std::fwrite(back.data(), 1, back.size(), file) != back.size()) {
+                        std::cout << "Failed to write trajectory data" << std::endl;
+                    }
+                    back.clear();
+                    lock.lock();
+                    backPending = false;
+                    writtenCondition.notify_one();
+                } else if (stopping) {
+                    return;
+                }
+            }
+        }
+
+        struct Residual {
+            int32_t x = 0;
+            int32_t y = 0;
+            int32_t angle = 0;
+        };
+
+        trajectory::FileHeader header;
+        std::vector<trajectory::BodyState> states; // Indexed by body index, like physicsObjects
+        std::vector<b2BodyId> ids;
+        std::vector<int64_t> stamps; // Frame a body last moved in
+        std::vector<Residual> residuals;
+        std::vector<uint32_t> removed;
+        std::vector<uint32_t> toggled;
+        std::vector<uint32_t> movedKeys;
+        size_t frameIndex = 0;
+        uint64_t bytesRecorded = 0;
+
+        std::FILE* file = nullptr;
+        std::vector<uint8_t> front; // Being encoded into by recordStep
+        std::vector<uint8_t> back;  // Being written by the writer thread
+        std::thread writerThread;
+        std::mutex mutex;
+        std::condition_variable pendingCondition;
+        std::condition_variable writtenCondition;
+        bool backPending = false;
+        bool stopping = false;
+    };
+}
+
+#endif // PHYSICS_RECORDER_H_INCLUDED
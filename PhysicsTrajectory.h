@@ -0,0 +1,269 @@
+#ifndef PHYSICS_TRAJECTORY_H_INCLUDED
+#define PHYSICS_TRAJECTORY_H_INCLUDED
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Binary trajectory format shared by the recorder and the reader.
+// Has no Box2D/SFML dependency so offline tools can read recordings on their own.
+//
+// File:  header, then frames back to back (one frame per world step).
+// Frame: u8 type, u32 step, u32 payload size, payload.
+//
+// Positions are quantized to 1/positionScale meters and angles to 1/4096 of a turn.
+// Keyframes store every live body absolutely as varints. Delta frames store:
+//   - removed body keys,
+//   - the keys that joined or left the set of moving bodies since the previous frame
+//     (the set is empty after a keyframe), so steady sets of awake bodies cost nothing,
+//   - a bit-packed block with, per moving body in key order, the error against a
+//     constant-velocity prediction (last position plus last movement): a single 1 bit
+//     when x, y and angle were all predicted exactly, otherwise a 0 bit and three
+//     zigzag exp-Golomb codes. The recorder keeps the prediction while it is within one
+//     quantization step of the true value, so smooth motion mostly costs one bit per body
+//     and decoded values are within one step (1/256 m, 1/4096 turn by default).
+// Header and frame header integers are little-endian; keys are varints.
+namespace trajectory {
+    const char magic[4] = {'P', 'S', 'T', 'R'};
+    const uint32_t version = 2;
+    const size_t headerSize = 24;
+    const size_t frameHeaderSize = 9;
+
+    enum FrameType : uint8_t {
+        DeltaFrame = 0,
+        KeyFrame = 1
+    };
+
+    struct FileHeader {
+        float timeStep = 1.0f / 60.0f;
+        float pixelsPerMeter = 32.0f;
+        float positionScale = 256.0f; // Quantization steps per meter (0.125 px at 32 px/m)
+        uint32_t keyframeInterval = 300;
+    };
+
+    // Quantized state of one body, kept identically by the encoder and the decoder
+    struct BodyState {
+        int32_t x = 0;
+        int32_t y = 0;
+        uint16_t angle = 0; // In angleSteps
+        int32_t dx = 0; // Last movement, used as the prediction for the next one
+        int32_t dy = 0;
+        int32_t dangle = 0;
+        bool alive = false;
+        bool moving = false; // Moved in the previous delta frame
+    };
+
+    const int32_t angleSteps = 4096; // Per turn
+
+    // Wraps an angle difference (or angle) in steps to [-angleSteps/2, angleSteps/2)
+    inline int32_t wrapAngle(int32_t steps) {
+        return ((steps & (angleSteps - 1)) ^ (angleSteps / 2)) - angleSteps / 2;
+    }
+
+    inline uint16_t quantizeAngle(float radians) {
+        const float radiansToSteps = angleSteps / 6.28318530718f;
+        int32_t steps = static_cast<int32_t>(radians * radiansToSteps + (radians < 0.0f ? -0.5f : 0.5f));
+        return static_cast<uint16_t>(steps & (angleSteps - 1));
+    }
+
+    inline float dequantizeAngle(uint16_t angle) {
+        // Signed so the result stays in [-pi, pi) like b2Rot_GetAngle
+        return wrapAngle(angle) * (6.28318530718f / angleSteps);
+    }
+
+    inline void putU32(std::vector<uint8_t>& out, uint32_t value) {
+        for (int i = 0; i < 4; i++) {
+            out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+
+    inline void putFloat(std::vector<uint8_t>& out, float value) {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        putU32(out, bits);
+    }
+
+    inline void putVarint(std::vector<uint8_t>& out, uint32_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    // Zigzag so small negative numbers stay small
+    inline uint32_t zigzag(int32_t value) {
+        return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+    }
+
+    inline int32_t unzigzag(uint32_t value) {
+        return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+    }
+
+    inline void putSigned(std::vector<uint8_t>& out, int32_t value) {
+        putVarint(out, zigzag(value));
+    }
+
+    // Appends bits most significant first; call finish() to flush and pad the last byte
+    class BitWriter {
+    public:
+        explicit BitWriter(std::vector<uint8_t>& out) : out(out) {}
+
+        void putBits(uint32_t value, int count) {
+            // Fewer than 32 bits are ever pending, so 32 more always fit
+            pending = (pending << count) | (count < 32 ? value & ((1u << count) - 1) : value);
+            pendingCount += count;
+            if (pendingCount >= 32) {
+                pendingCount -= 32;
+                uint32_t word = static_cast<uint32_t>(pending >> pendingCount);
+                out.push_back(static_cast<uint8_t>(word >> 24));
+                out.push_back(static_cast<uint8_t>(word >> 16));
+                out.push_back(static_cast<uint8_t>(word >> 8));
+                out.push_back(static_cast<uint8_t>(word));
+            }
+        }
+
+        // Exp-Golomb: value + 1 in binary, preceded by one zero per bit after the first
+        void putExpGolomb(uint32_t value) {
+            if (value == 0) {
+                putBits(1, 1); // By far the most common code
+                return;
+            }
+            uint64_t n = static_cast<uint64_t>(value) + 1;
+            int bits = 0;
+            while ((n >> bits) > 1) {
+                ++bits;
+            }
+            if (bits < 16) {
+                putBits(static_cast<uint32_t>(n), 2 * bits + 1); // The leading zeros come for free
+                return;
+            }
+            putBits(0, bits);
+            putBits(1, 1);
+            putBits(static_cast<uint32_t>(n), bits);
+        }
+
+        void finish() {
+            while (pendingCount >= 8) {
+                pendingCount -= 8;
+                out.push_back(static_cast<uint8_t>(pending >> pendingCount));
+            }
+            if (pendingCount > 0) {
+                out.push_back(static_cast<uint8_t>(pending << (8 - pendingCount)));
+                pendingCount = 0;
+            }
+        }
+
+    private:
+        std::vector<uint8_t>& out;
+        uint64_t pending = 0;
+        int pendingCount = 0;
+    };
+
+    class BitReader {
+    public:
+        BitReader(const uint8_t* in, const uint8_t* end) : in(in), end(end) {}
+
+        // Returns false past the end of the block
+        bool getBit(uint32_t& bit) {
+            if (bitIndex == 8) {
+                if (in == end) {
+                    return false;
+                }
+                current = *in++;
+                bitIndex = 0;
+            }
+            bit = (current >> (7 - bitIndex++)) & 1;
+            return true;
+        }
+
+        bool getExpGolomb(uint32_t& value) {
+            int zeros = 0;
+            uint32_t bit;
+            while (true) {
+                if (!getBit(bit)) {
+                    return false;
+                }
+                if (bit) {
+                    break;
+                }
+                if (++zeros > 32) {
+                    return false;
+                }
+            }
+            uint64_t n = 1;
+            for (int i = 0; i < zeros; ++i) {
+                if (!getBit(bit)) {
+                    return false;
+                }
+                n = (n << 1) | bit;
+            }
+            value = static_cast<uint32_t>(n - 1);
+            return true;
+        }
+
+    private:
+        const uint8_t* in;
+        const uint8_t* end;
+        uint8_t current = 0;
+        int bitIndex = 8;
+    };
+
+    inline uint32_t getU32(const uint8_t* in) {
+        return static_cast<uint32_t>(in[0]) | (static_cast<uint32_t>(in[1]) << 8) |
+               (static_cast<uint32_t>(in[2]) << 16) | (static_cast<uint32_t>(in[3]) << 24);
+    }
+
+    inline float getFloat(const uint8_t* in) {
+        uint32_t bits = getU32(in);
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    // Returns false if the varint runs past end
+    inline bool getVarint(const uint8_t*& in, const uint8_t* end, uint32_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 35 && in < end; shift += 7) {
+            uint8_t byte = *in++;
+            value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    inline bool getSigned(const uint8_t*& in, const uint8_t* end, int32_t& value) {
+        uint32_t raw;
+        if (!getVarint(in, end, raw)) {
+            return false;
+        }
+        value = unzigzag(raw);
+        return true;
+    }
+
+    inline void writeFileHeader(std::vector<uint8_t>& out, const FileHeader& header) {
+        for (char c : magic) {
+            out.push_back(static_cast<uint8_t>(c));
+        }
+        putU32(out, version);
+        putFloat(out, header.timeStep);
+        putFloat(out, header.pixelsPerMeter);
+        putFloat(out, header.positionScale);
+        putU32(out, header.keyframeInterval);
+    }
+
+    inline bool readFileHeader(const uint8_t* in, size_t size, FileHeader& header) {
+        if (size < headerSize || std::memcmp(in, magic, 4) != 0 || getU32(in + 4) != version) {
+            return false;
+        }
+        header.timeStep = getFloat(in + 8);
+        header.pixelsPerMeter = getFloat(in + 12);
+        header.positionScale = getFloat(in + 16);
+        header.keyframeInterval = getU32(in + 20);
+        return header.positionScale > 0.0f;
+    }
+}
+
+#endif // PHYSICS_TRAJECTORY_H_INCLUDED
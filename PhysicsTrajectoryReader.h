@@ -0,0 +1,347 @@
+#ifndef PHYSICS_TRAJECTORY_READER_H_INCLUDED
+#define PHYSICS_TRAJECTORY_READER_H_INCLUDED
+
+#include "PhysicsTrajectory.h"
+#include <iostream>
+#include <string>
+
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+// Reads trajectory files written by physics::TrajectoryRecorder.
+// The file is memory-mapped and frames are decoded on demand, so seeking only
+// replays from the nearest keyframe instead of from the start of the run.
+namespace trajectory {
+    struct BodyTransform {
+        int32_t key; // Body index, same key as physics::physicsObjects
+        float x;     // Meters
+        float y;
+        float angle; // Radians
+    };
+
+    class TrajectoryReader {
+    public:
+        TrajectoryReader() = default;
+
+        ~TrajectoryReader() {
+            close();
+        }
+
+        TrajectoryReader(const TrajectoryReader&) = delete;
+        TrajectoryReader& operator=(const TrajectoryReader&) = delete;
+
+        bool open(const std::string& path) {
+            close();
+
+            if (!mapFile(path)) {
+                std::cout << "Failed to map trajectory file " << path << std::endl;
+                return false;
+            }
+
+            if (!readFileHeader(data, size, header)) {
+                std::cout << "Not a trajectory file: " << path << std::endl;
+                close();
+                return false;
+            }
+
+            // Index the frames by hopping over payloads; a truncated last frame is dropped
+            size_t offset = headerSize;
+            while (offset + frameHeaderSize <= size) {
+                uint32_t payloadSize = getU32(data + offset + 5);
+                if (offset + frameHeaderSize + payloadSize > size) {
+                    break;
+                }
+                if (frameOffsets.empty() && data[offset] != KeyFrame) {
+                    std::cout << "Trajectory does not start with a keyframe" << std::endl;
+                    close();
+                    return false;
+                }
+                frameOffsets.push_back(offset);
+                offset += frameHeaderSize + payloadSize;
+            }
+
+            currentFrame = -1;
+            return true;
+        }
+
+        void close() {
+            unmapFile();
+            frameOffsets.clear();
+            states.clear();
+            transforms.clear();
+            currentFrame = -1;
+        }
+
+        size_t frameCount() const {
+            return frameOffsets.size();
+        }
+
+        const FileHeader& fileHeader() const {
+            return header;
+        }
+
+        // Decodes the given frame, replaying from the closest keyframe if needed
+        bool seek(size_t frame) {
+            if (frame >= frameOffsets.size()) {
+                return false;
+            }
+
+            size_t keyframe = frame;
+            while (data[frameOffsets[keyframe]] != KeyFrame) {
+                --keyframe; // Frame 0 is always a keyframe
+            }
+
+            // Keep going from where we are when no keyframe lies in between
+            size_t start = keyframe;
+            if (currentFrame >= static_cast<long long>(keyframe) && currentFrame < static_cast<long long>(frame)) {
+                start = static_cast<size_t>(currentFrame) + 1;
+            } else if (currentFrame == static_cast<long long>(frame)) {
+                return true;
+            }
+
+            for (size_t i = start; i <= frame; ++i) {
+                if (!decodeFrame(i)) {
+                    std::cout << "Corrupt trajectory frame " << i << std::endl;
+                    currentFrame = -1;
+                    return false;
+                }
+                currentFrame = static_cast<long long>(i);
+            }
+            transformsDirty = true;
+            return true;
+        }
+
+        bool next() {
+            return seek(static_cast<size_t>(currentFrame + 1));
+        }
+
+        long long frame() const {
+            return currentFrame;
+        }
+
+        // World step the current frame was recorded at
+        uint32_t step() const {
+            return currentFrame < 0 ? 0 : getU32(data + frameOffsets[currentFrame] + 1);
+        }
+
+        float time() const {
+            return step() * header.timeStep;
+        }
+
+        // Every body alive in the current frame, in key order
+        const std::vector<BodyTransform>& bodies() {
+            if (transformsDirty) {
+                transforms.clear();
+                for (size_t key = 0; key < states.size(); ++key) {
+                    const BodyState& state = states[key];
+                    if (state.alive) {
+                        transforms.push_back({static_cast<int32_t>(key),
+                                              state.x / header.positionScale,
+                                              state.y / header.positionScale,
+                                              dequantizeAngle(state.angle)});
+                    }
+                }
+                transformsDirty = false;
+            }
+            return transforms;
+        }
+
+    private:
+        BodyState& stateFor(uint32_t key) {
+            if (key >= states.size()) {
+                states.resize(static_cast<size_t>(key) + 1);
+            }
+            return states[key];
+        }
+
+        bool decodeFrame(size_t frame) {
+            const uint8_t* in = data + frameOffsets[frame];
+            uint8_t type = in[0];
+            const uint8_t* end = in + frameHeaderSize + getU32(in + 5);
+            in += frameHeaderSize;
+
+            uint32_t count;
+            uint32_t key = 0;
+
+            if (type == KeyFrame) {
+                for (auto& state : states) {
+                    state = BodyState();
+                }
+                if (!getVarint(in, end, count)) {
+                    return false;
+                }
+                for (uint32_t i = 0; i < count; ++i) {
+                    uint32_t gap, angle;
+                    int32_t x, y;
+                    if (!getVarint(in, end, gap) || !getSigned(in, end, x) ||
+                        !getSigned(in, end, y) || !getVarint(in, end, angle)) {
+                        return false;
+                    }
+                    key += gap;
+                    BodyState& state = stateFor(key);
+                    state.x = x;
+                    state.y = y;
+                    state.angle = static_cast<uint16_t>(angle);
+                    state.alive = true;
+                }
+                return true;
+            }
+
+            // Removed bodies first, so a recycled index starts again from zero
+            if (!getVarint(in, end, count)) {
+                return false;
+            }
+            for (uint32_t i = 0; i < count; ++i) {
+                uint32_t removedKey;
+                if (!getVarint(in, end, removedKey)) {
+                    return false;
+                }
+                stateFor(removedKey) = BodyState();
+            }
+
+            // Bodies that started or stopped moving, then one residual entry per moving body
+            if (!getVarint(in, end, count)) {
+                return false;
+            }
+            for (uint32_t i = 0; i < count; ++i) {
+                uint32_t gap;
+                if (!getVarint(in, end, gap)) {
+                    return false;
+                }
+                key += gap;
+                BodyState& state = stateFor(key);
+                state.moving = !state.moving;
+            }
+
+            BitReader bits(in, end);
+            for (size_t movingKey = 0; movingKey < states.size(); ++movingKey) {
+                BodyState& state = states[movingKey];
+                if (!state.moving) {
+                    continue;
+                }
+
+                uint32_t allPredicted;
+                int32_t rx = 0, ry = 0, ra = 0;
+                if (!bits.getBit(allPredicted)) {
+                    return false;
+                }
+                if (!allPredicted) {
+                    uint32_t zx, zy, za;
+                    if (!bits.getExpGolomb(zx) || !bits.getExpGolomb(zy) || !bits.getExpGolomb(za)) {
+                        return false;
+                    }
+                    rx = unzigzag(zx);
+                    ry = unzigzag(zy);
+                    ra = unzigzag(za);
+                }
+
+                // Same constant-velocity prediction as the recorder
+                int32_t x = state.x + state.dx + rx;
+                int32_t y = state.y + state.dy + ry;
+                uint16_t angle = static_cast<uint16_t>((state.angle + state.dangle + ra) & (angleSteps - 1));
+
+                state.dx = x - state.x;
+                state.dy = y - state.y;
+                state.dangle = wrapAngle(angle - state.angle);
+                state.x = x;
+                state.y = y;
+                state.angle = angle;
+                state.alive = true;
+            }
+            return true;
+        }
+
+        bool mapFile(const std::string& path) {
+#ifdef _WIN32
+            fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                     OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (fileHandle == INVALID_HANDLE_VALUE) {
+                return false;
+            }
+            LARGE_INTEGER fileSize;
+            if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0) {
+                unmapFile();
+                return false;
+            }
+            size = static_cast<size_t>(fileSize.QuadPart);
+            mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (!mappingHandle) {
+                unmapFile();
+                return false;
+            }
+            data = static_cast<const uint8_t*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+#else
+            fileDescriptor = ::open(path.c_str(), O_RDONLY);
+            if (fileDescriptor < 0) {
+                return false;
+            }
+            struct stat fileStat;
+            if (fstat(fileDescriptor, &fileStat) != 0 || fileStat.st_size == 0) {
+                unmapFile();
+                return false;
+            }
+            size = static_cast<size_t>(fileStat.st_size);
+            void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+            data = mapped == MAP_FAILED ? nullptr : static_cast<const uint8_t*>(mapped);
+#endif
+            if (!data) {
+                unmapFile();
+                return false;
+            }
+            return true;
+        }
+
+        void unmapFile() {
+#ifdef _WIN32
+            if (data) {
+                UnmapViewOfFile(data);
+            }
+            if (mappingHandle) {
+                CloseHandle(mappingHandle);
+                mappingHandle = nullptr;
+            }
+            if (fileHandle != INVALID_HANDLE_VALUE) {
+                CloseHandle(fileHandle);
+                fileHandle = INVALID_HANDLE_VALUE;
+            }
+#else
+            if (data) {
+                munmap(const_cast<uint8_t*>(data), size);
+            }
+            if (fileDescriptor >= 0) {
+                ::close(fileDescriptor);
+                fileDescriptor = -1;
+            }
+#endif
+            data = nullptr;
+            size = 0;
+        }
+
+        FileHeader header;
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+#ifdef _WIN32
+        HANDLE fileHandle = INVALID_HANDLE_VALUE;
+        HANDLE mappingHandle = nullptr;
+#else
+        int fileDescriptor = -1;
+#endif
+
+        std::vector<size_t> frameOffsets;
+        std::vector<BodyState> states; // Indexed by body key
+        std::vector<BodyTransform> transforms;
+        long long currentFrame = -1;
+        bool transformsDirty = true;
+    };
+}
+
+#endif // PHYSICS_TRAJECTORY_READER_H_INCLUDED
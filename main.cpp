@@ -1,11 +1,13 @@
 
 #include "PhysicsDebugDraw.h"
+#include "PhysicsQuery.h"
+#include "PhysicsRecorder.h"
 #include <chrono>
 #include <vector>
 #include <cstdlib>
 #include <ctime>
 
-int main() {
+int main(int argc, char* argv[]) {
     std::cout << "Physics System Simulator - Box2D 3.1.0 Integration Demo\n";
     std::cout << "=======================================================\n\n";
 
@@ -110,6 +112,7 @@ int main() {
     std::cout << "Simulation running at 60Hz with 4 sub-steps\n";
     std::cout << "Press SPACE to add more objects\n";
     std::cout << "Press R to reset simulation\n";
+    std::cout << "Drag objects with the left mouse button\n";
     std::cout << "Press ESC to exit\n\n";
 
     // Main game loop
@@ -117,6 +120,32 @@ int main() {
     int frameCount = 0;
     double totalPhysicsTime = 0.0;
 
+    // Spatial queries run on worker threads between steps; mouse picking goes through them
+    physics::QuerySystem querySystem;
+    physics::MouseDrag mouseDrag;
+
+    // Optional trajectory recording: PhysicsSimulator --record run.pstr
+    physics::TrajectoryRecorder recorder;
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (std::string(argv[i]) == "--record" && recorder.open(argv[i + 1], 1.0f / 60.0f)) {
+            std::cout << "Recording trajectory to " << argv[i + 1] << "\n";
+        }
+    }
+
+    // Recording is timed on its own so the physics step metrics keep meaning the same thing
+    double totalRecordTime = 0.0;
+    int recordedSteps = 0;
+    auto recordStep = [&](b2WorldId stepWorldId) {
+        if (!recorder.isOpen()) {
+            return;
+        }
+        auto recordStart = std::chrono::high_resolution_clock::now();
+        recorder.recordStep(stepWorldId);
+        auto recordEnd = std::chrono::high_resolution_clock::now();
+        totalRecordTime += std::chrono::duration_cast<std::chrono::microseconds>(recordEnd - recordStart).count();
+        recordedSteps++;
+    };
+
     // Main game loop
     while (window.isOpen()) {
         // Handle events
@@ -155,6 +184,23 @@ int main() {
                     std::cout << "Simulation reset with " << physics::physicsObjects.size() << " objects\n";
                 }
             }
+            else if (const auto* mousePressed = event->getIf<sf::Event::MouseButtonPressed>())
+            {
+                if (mousePressed->button == sf::Mouse::Button::Left) {
+                    sf::Vector2f point = window.mapPixelToCoords(mousePressed->position); // Window pixels to world pixels
+                    physics::beginMouseDrag(querySystem, worldId, mouseDrag, point);
+                }
+            }
+            else if (const auto* mouseReleased = event->getIf<sf::Event::MouseButtonReleased>())
+            {
+                if (mouseReleased->button == sf::Mouse::Button::Left)
+                    physics::endMouseDrag(mouseDrag);
+            }
+            else if (const auto* mouseMoved = event->getIf<sf::Event::MouseMoved>())
+            {
+                sf::Vector2f point = window.mapPixelToCoords(mouseMoved->position);
+                physics::updateMouseDrag(mouseDrag, point);
+            }
         } //ends the event loop
 
         // Remainder of main loop
@@ -167,6 +213,8 @@ int main() {
         b2World_Step(worldId, timeStep, subSteps);
         auto physicsEnd = std::chrono::high_resolution_clock::now();
 
+        recordStep(worldId);
+
         double physicsTime = std::chrono::duration_cast<std::chrono::microseconds>(physicsEnd - physicsStart).count();
         totalPhysicsTime += physicsTime;
         frameCount++;
@@ -195,9 +243,11 @@ int main() {
                              "\nPhysics Step: " + std::to_string(physicsTime / 1000.0).substr(0, 5) + " ms" +
                              "\nAvg Physics Time: " + std::to_string((totalPhysicsTime / frameCount) / 1000.0).substr(0, 5) + " ms" +
                              "\nSub-steps: " + std::to_string(subSteps) +
+                             (recordedSteps > 0 ? "\nAvg Record Time: " + std::to_string((totalRecordTime / recordedSteps) / 1000.0).substr(0, 5) + " ms" : "") +
                              "\n\nControls:" +
                              "\nSPACE - Add object" +
                              "\nR - Reset simulation" +
+                             "\nMouse - Drag object" +
                              "\nESC - Exit";
 
             // set the string to display
@@ -206,14 +256,28 @@ int main() {
             window.draw(text);
         }
 
-        physics::displayWorld(worldId, window); //draws everything
+        physics::displayWorld(worldId, window, recordStep); //draws everything
 
         // Display everything on the video card to the monitor
         window.display();
 
     } //ends the game loop
 
+    if (recorder.isOpen()) {
+        double avgRecordTime = recordedSteps > 0 ? totalRecordTime / recordedSteps : 0.0;
+        double avgPhysicsTime = frameCount > 0 ? totalPhysicsTime / frameCount : 0.0;
+        std::cout << "Recorded " << recorder.frames() << " frames ("
+                  << recorder.bytes() / (1024.0 * 1024.0) << " MB), average record time "
+                  << avgRecordTime / 1000.0 << " ms per step";
+        if (avgPhysicsTime > 0.0) {
+            std::cout << " (" << 100.0 * avgRecordTime / avgPhysicsTime << "% of a physics step)";
+        }
+        std::cout << "\n";
+        recorder.close();
+    }
+
     // Clean up existing objects
+    physics::endMouseDrag(mouseDrag);
     physics::resetObjects();
 
     b2DestroyWorld(worldId);